@@ -0,0 +1,187 @@
+#include "capture.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static FILE *g_file = NULL;
+static pthread_t g_writer;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t g_drained = PTHREAD_COND_INITIALIZER;
+static int g_stop = 0;
+
+/* Records are appended to g_buf, the writer thread swaps it with g_spare */
+static char *g_buf;
+static char *g_spare;
+static size_t g_buf_len = 0;
+static int g_writing = 0;
+
+/**
+ * Background writer, flushes the buffer when full, on timeout or on close.
+ */
+static void *capture_writer(void *)
+{
+    pthread_mutex_lock(&g_lock);
+    while (1) {
+        if (g_buf_len == 0 && !g_stop) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += NS_CAPTURE_FLUSH_TIMEOUT / (1000 * 1000);
+            pthread_cond_timedwait(&g_filled, &g_lock, &ts);
+        }
+        if (g_buf_len > 0) {
+            char *buf = g_buf;
+            size_t len = g_buf_len;
+            g_buf = g_spare;
+            g_spare = buf;
+            g_buf_len = 0;
+            g_writing = 1;
+            pthread_mutex_unlock(&g_lock);
+
+            if (fwrite(buf, 1, len, g_file) != len || fflush(g_file)) {
+                perror("capture");
+            }
+
+            pthread_mutex_lock(&g_lock);
+            g_writing = 0;
+            pthread_cond_broadcast(&g_drained);
+        } else if (g_stop) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+    return NULL;
+}
+
+/**
+ * Start capturing all sent and received packets into the file 'path'.
+ *
+ * @return 0 on success, -1 on error
+ */
+int ns_capture_open(const char *path, unsigned short id, const char *name)
+{
+    ns_capture_header_t header;
+
+    if ((g_file = fopen(path, "wb")) == NULL) {
+        perror("fopen");
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NS_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = htons(NS_CAPTURE_VERSION);
+    header.id = htons(id);
+    strncpy(header.name, name, sizeof(header.name) - 1);
+    if (fwrite(&header, sizeof(header), 1, g_file) != 1) {
+        perror("fwrite");
+        fclose(g_file); g_file = NULL;
+        return -1;
+    }
+
+    g_buf = (char *)malloc(NS_CAPTURE_BUFFER_SIZE);
+    g_spare = (char *)malloc(NS_CAPTURE_BUFFER_SIZE);
+    g_buf_len = 0;
+    g_stop = 0;
+    if (pthread_create(&g_writer, NULL, capture_writer, NULL)) {
+        perror("pthread_create");
+        free(g_buf); free(g_spare);
+        fclose(g_file); g_file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Append a packet to the capture. Does nothing if no capture is running.
+ *
+ * Only blocks if both buffers are full, i.e. the disk cannot keep up.
+ */
+void ns_capture_write(ns_capture_dir_t dir, time_val ts, const struct sockaddr_in *sa, const void *data, size_t len)
+{
+    ns_capture_record_t rec;
+
+    if (g_file == NULL) {
+        return;
+    }
+    if (len > sizeof(ns_bulk_packet_t)) {
+        len = sizeof(ns_bulk_packet_t);
+    }
+    time2net(ts, rec.time);
+    rec.dir = dir;
+    rec.addr = sa->sin_addr.s_addr;
+    rec.port = sa->sin_port;
+    rec.len = htons(len);
+
+    size_t size = sizeof(rec) + len;
+    pthread_mutex_lock(&g_lock);
+    while (g_buf_len + size > NS_CAPTURE_BUFFER_SIZE) {
+        pthread_cond_signal(&g_filled);
+        pthread_cond_wait(&g_drained, &g_lock);
+    }
+    memcpy(g_buf + g_buf_len, &rec, sizeof(rec));
+    memcpy(g_buf + g_buf_len + sizeof(rec), data, len);
+    g_buf_len += size;
+    if (g_buf_len + sizeof(rec) + sizeof(ns_bulk_packet_t) > NS_CAPTURE_BUFFER_SIZE && !g_writing) {
+        pthread_cond_signal(&g_filled);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * Flush all pending records and stop the capture.
+ */
+void ns_capture_close()
+{
+    if (g_file == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&g_lock);
+    g_stop = 1;
+    pthread_cond_signal(&g_filled);
+    pthread_mutex_unlock(&g_lock);
+    pthread_join(g_writer, NULL);
+
+    fclose(g_file);
+    g_file = NULL;
+    free(g_buf);
+    free(g_spare);
+}
+
+/**
+ * Read and check the header of a capture file.
+ *
+ * @return 0 on success, -1 if this is no (supported) capture file
+ */
+int ns_capture_read_header(FILE *f, ns_capture_header_t *header)
+{
+    if (fread(header, sizeof(ns_capture_header_t), 1, f) != 1 ||
+        memcmp(header->magic, NS_CAPTURE_MAGIC, sizeof(header->magic)) ||
+        ntohs(header->version) != NS_CAPTURE_VERSION) {
+        return -1;
+    }
+    header->name[sizeof(header->name) - 1] = '\0';
+    return 0;
+}
+
+/**
+ * Read the next record of a capture file and its packet data.
+ *
+ * Data beyond size bytes is skipped.
+ *
+ * @param len Returns the number of bytes stored in data
+ * @return 0 on success, -1 at the end of the file
+ */
+int ns_capture_read(FILE *f, ns_capture_record_t *rec, void *data, size_t size, size_t *len)
+{
+    if (fread(rec, sizeof(ns_capture_record_t), 1, f) != 1) {
+        return -1;
+    }
+    size_t rec_len = ntohs(rec->len);
+    size_t n = rec_len < size ? rec_len : size;
+    if (fread(data, 1, n, f) != n || (rec_len > n && fseek(f, rec_len - n, SEEK_CUR))) {
+        return -1;
+    }
+    *len = n;
+    return 0;
+}
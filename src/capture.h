@@ -0,0 +1,58 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "name.h"
+
+#include <stdio.h>
+
+#define NS_CAPTURE_MAGIC "NSCP"
+#define NS_CAPTURE_VERSION 2
+
+/**
+ * Size of each of the two capture write buffers in [bytes]
+ */
+#define NS_CAPTURE_BUFFER_SIZE (64 * 1024)
+
+/**
+ * Maximum time a record stays in the write buffer in [us]
+ */
+#define NS_CAPTURE_FLUSH_TIMEOUT (1000 * 1000)
+
+/**
+ * Direction of a captured packet.
+ */
+typedef enum ns_capture_dir {
+    NS_CAPTURE_RECEIVED = 0,
+    NS_CAPTURE_SENT = 1
+} ns_capture_dir_t;
+
+/**
+ * Capture file header, followed by any number of records.
+ */
+typedef struct ns_capture_header {
+    char magic[4];
+    unsigned short version;
+    unsigned short id;
+    char name[12];
+} __attribute((packed)) ns_capture_header_t;
+
+/**
+ * A single captured packet, followed by len bytes of packet data.
+ * All fields are in network byte order.
+ */
+typedef struct ns_capture_record {
+    char time[8];
+    unsigned char dir;
+    unsigned int addr;
+    unsigned short port;
+    unsigned short len;
+} __attribute((packed)) ns_capture_record_t;
+
+int ns_capture_open(const char *path, unsigned short id, const char *name);
+void ns_capture_write(ns_capture_dir_t dir, time_val ts, const struct sockaddr_in *sa, const void *data, size_t len);
+void ns_capture_close();
+
+int ns_capture_read_header(FILE *f, ns_capture_header_t *header);
+int ns_capture_read(FILE *f, ns_capture_record_t *rec, void *data, size_t size, size_t *len);
+
+#endif
@@ -0,0 +1,130 @@
+#include "detector.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static void phi_push(ns_phi_t *phi, time_val sample)
+{
+    if (phi->count == NS_PHI_WINDOW_SIZE) {
+        time_val old = phi->intervals[phi->pos];
+        phi->sum -= old;
+        phi->sum_sq -= (double)old * old;
+    } else {
+        phi->count++;
+    }
+    phi->intervals[phi->pos] = sample;
+    phi->sum += sample;
+    phi->sum_sq += (double)sample * sample;
+    phi->pos = (phi->pos + 1) % NS_PHI_WINDOW_SIZE;
+}
+
+/**
+ * Reset the heartbeat history of a peer.
+ *
+ * The window is bootstrapped with two samples around the expected interval,
+ * so the first suspicion does not depend on a single measurement.
+ */
+void ns_phi_init(ns_phi_t *phi, time_val now, time_val interval)
+{
+    unsigned int received = phi->received;
+    unsigned int missed = phi->missed;
+
+    memset(phi, 0, sizeof(ns_phi_t));
+    phi->last = now;
+    phi->interval = interval;
+    phi->received = received;
+    phi->missed = missed;
+    phi_push(phi, interval - interval / 4);
+    phi_push(phi, interval + interval / 4);
+}
+
+/**
+ * Start the history of a peer known from another packet than HELLO.
+ *
+ * Its interval is unknown, so assume the slowest one a peer may advertise.
+ * The first HELLO replaces this guess.
+ */
+void ns_phi_seed(ns_phi_t *phi, time_val now)
+{
+    ns_phi_init(phi, now, NS_HELLO_MAX_TIMEOUT);
+    phi->seeded = 1;
+}
+
+/**
+ * Record a HELLO received at 'now' from a peer advertising 'interval'.
+ */
+void ns_phi_heartbeat(ns_phi_t *phi, time_val now, time_val interval)
+{
+    if (phi->seeded || interval != phi->interval) {
+        /* First HELLO or a new HELLO rate, old samples are meaningless */
+        ns_phi_init(phi, now, interval);
+        phi->received++;
+        return;
+    }
+
+    time_val gap = now - phi->last;
+    time_val n = (gap + interval / 2) / interval;
+    if (n > 1) {
+        phi->missed += n - 1;
+    }
+    phi->received++;
+    if (phi->received + phi->missed > 4 * NS_PHI_WINDOW_SIZE) {
+        phi->received /= 2;
+        phi->missed /= 2;
+    }
+    phi_push(phi, gap);
+    phi->last = now;
+}
+
+/**
+ * Suspicion level of a peer at 'now'.
+ *
+ * phi = -log10(P(next HELLO arrives later than now)), assuming normally
+ * distributed inter-arrival times. The advertised interval is allowed as
+ * acceptable pause on top of the mean, so a single lost HELLO is no reason
+ * for suspicion.
+ */
+double ns_phi_value(const ns_phi_t *phi, time_val now)
+{
+    double mean = (double)phi->sum / phi->count;
+    double var = phi->sum_sq / phi->count - mean * mean;
+    double sd = var > 0 ? sqrt(var) : 0;
+    if (sd < NS_PHI_MIN_STD_DEVIATION) {
+        sd = NS_PHI_MIN_STD_DEVIATION;
+    }
+
+    double y = ((now - phi->last) - mean - phi->interval) / (sd * M_SQRT2);
+    double p_later = 0.5 * erfc(y);
+    if (p_later < DBL_MIN) {
+        p_later = DBL_MIN;
+    }
+    return -log10(p_later);
+}
+
+/**
+ * Estimated fraction of HELLO messages from this peer that got lost.
+ */
+double ns_phi_loss(const ns_phi_t *phi)
+{
+    unsigned int total = phi->received + phi->missed;
+    return total ? (double)phi->missed / total : 0.0;
+}
+
+/**
+ * Compute the HELLO interval for the given cluster size and packet loss.
+ *
+ * Larger clusters send less often to keep broadcast traffic bounded, lossy
+ * networks send more often so that peers still collect enough samples.
+ */
+time_val ns_hello_interval(time_val base, unsigned int peers, double loss)
+{
+    time_val t = base * (1 + peers / NS_HELLO_PEERS_PER_STEP);
+    t = (time_val)(t * (1.0 - loss));
+    if (t < NS_HELLO_MIN_TIMEOUT) {
+        t = NS_HELLO_MIN_TIMEOUT;
+    } else if (t > NS_HELLO_MAX_TIMEOUT) {
+        t = NS_HELLO_MAX_TIMEOUT;
+    }
+    return t - t % NS_HELLO_TIMEOUT_STEP;
+}
@@ -0,0 +1,79 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include "clock.h"
+
+/**
+ * Number of HELLO inter-arrival times kept per peer.
+ */
+#define NS_PHI_WINDOW_SIZE 32
+
+/**
+ * Suspicion level above which a peer is considered dead.
+ */
+#define NS_PHI_THRESHOLD 8.0
+
+/**
+ * Lower bound for the inter-arrival standard deviation in [us]
+ */
+#define NS_PHI_MIN_STD_DEVIATION (500 * 1000)
+
+/**
+ * How often peers are checked against the threshold in [us]
+ */
+#define NS_PHI_CHECK_INTERVAL (1000 * 1000)
+
+/**
+ * A HELLO from a removed peer within this time counts as false positive in [us]
+ */
+#define NS_PHI_FALSE_POSITIVE_WINDOW (60 * 1000 * 1000)
+
+/**
+ * Bounds and step size of the adaptive HELLO interval in [us]
+ */
+#define NS_HELLO_MIN_TIMEOUT (2 * 1000 * 1000)
+#define NS_HELLO_MAX_TIMEOUT (30 * 1000 * 1000)
+#define NS_HELLO_TIMEOUT_STEP (1000 * 1000)
+
+/**
+ * Number of peers after which the HELLO interval is increased by one base interval.
+ */
+#define NS_HELLO_PEERS_PER_STEP 32
+
+/**
+ * Heartbeat history of a single peer.
+ */
+typedef struct ns_phi
+{
+    time_val intervals[NS_PHI_WINDOW_SIZE];
+    int count;
+    int pos;
+    time_val sum;
+    double sum_sq;
+    time_val last;
+    time_val interval;      /* HELLO interval advertised by the peer */
+    unsigned int received;
+    unsigned int missed;
+    int seeded;             /* no HELLO yet, interval is a guess */
+} ns_phi_t;
+
+/**
+ * Failure detector statistics reported by the node.
+ */
+typedef struct ns_phi_stats
+{
+    unsigned int suspicions;
+    unsigned int false_positives;
+    time_val latency_sum;
+    time_val latency_max;
+} ns_phi_stats_t;
+
+void ns_phi_init(ns_phi_t *phi, time_val now, time_val interval);
+void ns_phi_seed(ns_phi_t *phi, time_val now);
+void ns_phi_heartbeat(ns_phi_t *phi, time_val now, time_val interval);
+double ns_phi_value(const ns_phi_t *phi, time_val now);
+double ns_phi_loss(const ns_phi_t *phi);
+
+time_val ns_hello_interval(time_val base, unsigned int peers, double loss);
+
+#endif
@@ -0,0 +1,216 @@
+#include "detector.h"
+#include "name.h"
+#include "node.h"
+#include "vclock.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Jitter of the simulated HELLO messages in [us]
+ */
+#define NS_CHECK_JITTER (20 * 1000)
+
+/**
+ * Id of the checked node, all simulated peers have lower ids and let it win the election.
+ */
+#define NS_CHECK_NODE_ID 100
+
+/**
+ * A broadcast of the checked node, delivered back to it like the network does.
+ */
+typedef struct loopback {
+    ns_bulk_packet_t pack;
+    size_t len;
+} loopback_t;
+
+static std::deque<loopback_t> g_loopback;
+static unsigned long g_elections = 0;
+static int g_is_master = 0;
+static time_val g_first_interval = 0;
+static time_val g_interval = 0;
+
+static struct sockaddr_in peer_addr(unsigned short id)
+{
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(NS_DEFAULT_PORT);
+    sa.sin_addr.s_addr = htonl(0x0a000000 + id);
+    return sa;
+}
+
+/**
+ * Watch the packets of the checked node: its HELLO interval and any
+ * election it starts after it became master.
+ */
+static void check_sent(const void *data, size_t len, const struct sockaddr_in *sa)
+{
+    const ns_packet_t *pack = (const ns_packet_t *)data;
+
+    switch (ntohs(pack->type)) {
+        case HELLO:
+            g_interval = net2time((char *)pack->payload.time);
+            if (!g_is_master) {
+                g_first_interval = g_interval;
+            }
+            break;
+        case MASTER:
+            g_is_master = 1;
+            break;
+        case START_ELECTION:
+            if (g_is_master) {
+                g_elections++;
+            }
+            break;
+    }
+    if (sa->sin_addr.s_addr == htonl(INADDR_BROADCAST)) {
+        loopback_t lb;
+        memset(&lb, 0, sizeof(lb));
+        lb.len = len < sizeof(lb.pack) ? len : sizeof(lb.pack);
+        memcpy(&lb.pack, data, lb.len);
+        g_loopback.push_back(lb);
+    }
+}
+
+/**
+ * Hand the node its own broadcasts, sent by the handler that just returned.
+ */
+static void deliver_loopback()
+{
+    while (!g_loopback.empty()) {
+        loopback_t lb = g_loopback.front();
+        g_loopback.pop_front();
+        ns_node_receive(&lb.pack, lb.len, peer_addr(NS_CHECK_NODE_ID));
+    }
+}
+
+/**
+ * Count the peers the node dropped since the last call.
+ */
+static unsigned long count_removals()
+{
+    static unsigned int last = 0;
+    ns_node_state_t state;
+    unsigned long removed = 0;
+
+    ns_node_state(&state);
+    if (state.peers < last) {
+        removed = last - state.peers;
+    }
+    last = state.peers;
+    return removed;
+}
+
+/**
+ * Whether the k-th HELLO of a peer gets lost, counting from 1.
+ */
+static int is_lost(unsigned long k, int single, int every, int burst)
+{
+    if (single) {
+        return k == (unsigned long)single;
+    }
+    return every && (k - 1) % every >= (unsigned long)(every - burst);
+}
+
+static void print_usage(const char *prog_name)
+{
+    fprintf(stderr, "Usage: %s [-n PEERS] [-t SECONDS] [-s K | -d N [-b B]]\n"
+           "    -n : number of simulated peers (default 3)\n"
+           "    -t : virtual run time (default 300)\n"
+           "    -s : lose only the K-th HELLO of every peer\n"
+           "    -d : lose B (default 1) of every N HELLOs of every peer\n"
+           "Fails if the node removes a peer or starts an election, and with -d\n"
+           "if its HELLO interval does not adapt to the loss.\n", prog_name);
+}
+
+int main(int argc, char *argv[])
+{
+    int peers = 3, seconds = 300, single = 0, every = 0, burst = 1, opt;
+
+    while ((opt = getopt(argc, argv, "n:t:s:d:b:")) != -1) {
+        switch (opt) {
+            case 'n': peers = atoi(optarg); break;
+            case 't': seconds = atoi(optarg); break;
+            case 's': single = atoi(optarg); break;
+            case 'd': every = atoi(optarg); break;
+            case 'b': burst = atoi(optarg); break;
+            default: print_usage(argv[0]); exit(1);
+        }
+    }
+    if (peers < 1 || peers >= NS_CHECK_NODE_ID || seconds < 1 || (single && every) ||
+        every < 0 || burst < 1 || (every && burst >= every)) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    /* The node reports every packet */
+    freopen("/dev/null", "w", stdout);
+    srandom(1);
+
+    time_val start = 1000LL * 1000 * 1000 * 1000;
+    time_val end = start + seconds * 1000LL * 1000;
+    vclock_set(start);
+    ns_set_send_hook(check_sent);
+    ns_node_init(-1, peer_addr(NS_CHECK_NODE_ID), NS_CHECK_NODE_ID, "check");
+    deliver_loopback();
+
+    /* HELLO messages of the peers, at a random phase and jittered around their fixed interval */
+    std::multimap<time_val, unsigned short> hellos;
+    std::vector<unsigned long> sent(peers + 1, 0);
+    std::vector<time_val> phase(peers + 1, 0);
+    for (unsigned short id = 1; id <= peers; id++) {
+        phase[id] = start + random() % NS_HELLO_TIMEOUT;
+        hellos.insert(std::make_pair(phase[id], id));
+    }
+
+    unsigned long total = 0, lost = 0, removed = 0;
+    while (get_time() < end) {
+        time_val now = get_time();
+        time_val next = ns_node_next_timeout();
+        if (next <= now) {
+            next = now + 1000;
+        }
+        if (next < hellos.begin()->first) {
+            vclock_set(next);
+            ns_node_timeout();
+            deliver_loopback();
+            removed += count_removals();
+            continue;
+        }
+
+        unsigned short id = hellos.begin()->second;
+        vclock_set(hellos.begin()->first);
+        hellos.erase(hellos.begin());
+        unsigned long k = ++sent[id];
+        hellos.insert(std::make_pair(phase[id] + k * NS_HELLO_TIMEOUT + random() % (2 * NS_CHECK_JITTER) - NS_CHECK_JITTER, id));
+        total++;
+        if (is_lost(k, single, every, burst)) {
+            lost++;
+            continue;
+        }
+
+        ns_packet_t pack;
+        memset(&pack, 0, sizeof(pack));
+        pack.sender_id = htons(id);
+        pack.type = htons(HELLO);
+        time2net(NS_HELLO_TIMEOUT, pack.payload.time);
+        ns_node_receive(&pack, sizeof(pack), peer_addr(id));
+        deliver_loopback();
+        removed += count_removals();
+    }
+
+    time_val expected = ns_hello_interval(NS_HELLO_TIMEOUT, peers, 0);
+    int adapted = g_interval < expected;
+    fprintf(stderr, "%d peers, %lu of %lu HELLOs lost: %lu peers removed, %lu elections, "
+            "HELLO interval %lld ms -> %lld ms (%lld ms without loss)\n",
+            peers, lost, total,
+            removed, g_elections, g_first_interval / 1000, g_interval / 1000, expected / 1000);
+    return removed || g_elections || (every && !adapted) ? 1 : 0;
+}
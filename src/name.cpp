@@ -1,10 +1,37 @@
 #include "name.h"
+#include "capture.h"
 #include "clock.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+static ns_send_hook_t g_send_hook = NULL;
+
+/**
+ * Send a packet, recording it if a capture is running.
+ *
+ * With a send hook installed the packet is handed to the hook instead of the socket.
+ */
+static int ns_sendto(int sock, const void *data, size_t len, struct sockaddr_in *sa)
+{
+    ns_capture_write(NS_CAPTURE_SENT, get_time(), sa, data, len);
+    if (g_send_hook) {
+        g_send_hook(data, len, sa);
+        return len;
+    }
+    return sendto(sock, data, len, 0, (struct sockaddr *)sa, sizeof(struct sockaddr_in));
+}
+
+/**
+ * Install a hook receiving all outgoing packets instead of the socket.
+ */
+void ns_set_send_hook(ns_send_hook_t hook)
+{
+    g_send_hook = hook;
+}
+
 /**
  *
  */
@@ -31,8 +58,11 @@ void ns_init(int *sock, struct sockaddr_in *sa, int port)
 
 /**
  * Broadcast a HELLO message.
+ *
+ * The payload carries the sender's current HELLO interval so that peers
+ * can tell lost messages from a slower rate.
  */
-void ns_send_HELLO(int sock, struct sockaddr_in sa, unsigned short id)
+void ns_send_HELLO(int sock, struct sockaddr_in sa, unsigned short id, time_val interval)
 {
     struct ns_packet pack;
 
@@ -40,8 +70,9 @@ void ns_send_HELLO(int sock, struct sockaddr_in sa, unsigned short id)
     memset(&pack, 0, sizeof(pack));
     pack.sender_id = htons(id);
     pack.type = htons(HELLO);
+    time2net(interval, pack.payload.time);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -60,7 +91,7 @@ void ns_send_GET_NAME(int sock, struct sockaddr_in sa, unsigned short id, struct
     pack.type = htons(GET_NAME);
     pack.payload.id = htons(pid);
     sa.sin_addr.s_addr = psa.sin_addr.s_addr;
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto");
     }
 }
@@ -79,7 +110,7 @@ void ns_send_GET_ID(int sock, struct sockaddr_in sa, unsigned short id, struct s
     pack.type = htons(GET_ID);
     pack.payload.id = htons(pid);
     sa.sin_addr.s_addr = psa.sin_addr.s_addr;
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto");
     }
 }
@@ -96,7 +127,91 @@ void ns_send_NAME_ID(int sock, struct sockaddr_in sa, unsigned short id, const c
     pack.type = htons(NAME_ID);
     strncpy(pack.payload.name, name, strlen(name));
     sa.sin_addr.s_addr = psa.sin_addr.s_addr;
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
+        perror("sendto");
+    }
+}
+
+/**
+ * Whether packets of this type use ns_bulk_packet_t.
+ */
+int ns_is_bulk(unsigned short type)
+{
+    return type == GET_NAMES || type == GET_IDS || type == NAME_IDS;
+}
+
+/**
+ * Size of a bulk packet carrying count payload elements.
+ */
+size_t ns_bulk_packet_size(unsigned short type, unsigned short count)
+{
+    size_t elem;
+
+    switch (type) {
+        case GET_NAMES: elem = sizeof(unsigned short); break;
+        case GET_IDS: elem = 12; break;
+        default: elem = sizeof(ns_name_id_t); break;
+    }
+    return offsetof(ns_bulk_packet_t, payload) + count * elem;
+}
+
+/**
+ * Send a GET_NAMES package asking a peer for the names of up to NS_BULK_MAX IDs.
+ */
+void ns_send_GET_NAMES(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const unsigned short *cids, unsigned short count)
+{
+    struct ns_bulk_packet pack;
+
+    memset(&pack, 0, sizeof(pack));
+    pack.sender_id = htons(id);
+    pack.type = htons(GET_NAMES);
+    pack.count = htons(count);
+    for (unsigned short i = 0; i < count; i++) {
+        pack.payload.ids[i] = htons(cids[i]);
+    }
+    sa.sin_addr.s_addr = psa.sin_addr.s_addr;
+    if (ns_sendto(sock, &pack, ns_bulk_packet_size(GET_NAMES, count), &sa) < 0) {
+        perror("sendto");
+    }
+}
+
+/**
+ * Send a GET_IDS package asking a peer for the IDs of up to NS_BULK_MAX names.
+ */
+void ns_send_GET_IDS(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const char names[][12], unsigned short count)
+{
+    struct ns_bulk_packet pack;
+
+    memset(&pack, 0, sizeof(pack));
+    pack.sender_id = htons(id);
+    pack.type = htons(GET_IDS);
+    pack.count = htons(count);
+    memcpy(pack.payload.names, names, count * sizeof(pack.payload.names[0]));
+    sa.sin_addr.s_addr = psa.sin_addr.s_addr;
+    if (ns_sendto(sock, &pack, ns_bulk_packet_size(GET_IDS, count), &sa) < 0) {
+        perror("sendto");
+    }
+}
+
+/**
+ * Send a NAME_IDS package answering GET_NAMES or GET_IDS.
+ *
+ * The entry IDs are in host byte order, the addresses in network byte order.
+ */
+void ns_send_NAME_IDS(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const ns_name_id_t *entries, unsigned short count)
+{
+    struct ns_bulk_packet pack;
+
+    memset(&pack, 0, sizeof(pack));
+    pack.sender_id = htons(id);
+    pack.type = htons(NAME_IDS);
+    pack.count = htons(count);
+    memcpy(pack.payload.entries, entries, count * sizeof(ns_name_id_t));
+    for (unsigned short i = 0; i < count; i++) {
+        pack.payload.entries[i].id = htons(entries[i].id);
+    }
+    sa.sin_addr.s_addr = psa.sin_addr.s_addr;
+    if (ns_sendto(sock, &pack, ns_bulk_packet_size(NAME_IDS, count), &sa) < 0) {
         perror("sendto");
     }
 }
@@ -113,7 +228,7 @@ void ns_send_START_ELECTION(int sock, struct sockaddr_in sa, unsigned short id)
     pack.sender_id = htons(id);
     pack.type = htons(START_ELECTION);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -130,7 +245,7 @@ void ns_send_ELECTION(int sock, struct sockaddr_in sa, unsigned short id)
     pack.sender_id = htons(id);
     pack.type = htons(ELECTION);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -147,7 +262,7 @@ void ns_send_MASTER(int sock, struct sockaddr_in sa, unsigned short id)
     pack.sender_id = htons(id);
     pack.type = htons(MASTER);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -164,7 +279,7 @@ void ns_send_START_SYNC(int sock, struct sockaddr_in sa, unsigned short id)
     pack.sender_id = htons(id);
     pack.type = htons(START_SYNC);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 
@@ -183,7 +298,7 @@ void ns_send_SYNC(int sock, struct sockaddr_in sa, unsigned short id, time_val t
     pack.type = htons(SYNC);
     time2net(ts, pack.payload.time);
     /* inet_addr("127.0.0.1"); */
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -201,7 +316,7 @@ void ns_send_SYNC(int sock, struct sockaddr_in sa, unsigned short id, time_val t
     pack.type = htons(SYNC);
     time2net(ts, pack.payload.time);
     sa.sin_addr.s_addr = psa.sin_addr.s_addr;
-    if (sendto(sock, (void *)&pack, sizeof(pack), 0, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+    if (ns_sendto(sock, &pack, sizeof(pack), &sa) < 0) {
         perror("sendto"); exit(6);
     }
 }
@@ -2,19 +2,43 @@
 #define NAME_H
 
 #include "clock.h"
+#include "detector.h"
 
 #include <arpa/inet.h>
 
 #define NS_DEFAULT_PORT 57539
 
 /**
- * Send HELLO message timeout in [us]
+ * Base send HELLO message timeout in [us], see ns_hello_interval()
  */
 #define NS_HELLO_TIMEOUT (10 * 1000 * 1000)
-#define NS_HELLO_LAST_TIME_DIFFERENCE (NS_HELLO_TIMEOUT * 3)
 #define NS_ELECTION_TIMEOUT (300 * 1000)
 #define NS_MASTER_TIMEOUT (600 * 1000)
 #define NS_TIME_SYNC_TIMEOUT (300 * 1000)
+/**
+ * Time between two time sync rounds of the master in [us]
+ */
+#define NS_TIME_SYNC_INTERVAL NS_HELLO_TIMEOUT
+
+/**
+ * Time unresolved IDs are collected before sending one GET_NAMES in [us]
+ */
+#define NS_RESOLVE_WINDOW (20 * 1000)
+/**
+ * Time after which IDs not answered by GET_NAMES are asked for one by one in [us]
+ */
+#define NS_RESOLVE_RETRY_TIMEOUT (500 * 1000)
+/**
+ * Build with NS_RESOLVE_BATCH=0 to ask every peer with its own GET_NAME.
+ */
+#ifndef NS_RESOLVE_BATCH
+#define NS_RESOLVE_BATCH 1
+#endif
+
+/**
+ * Maximum number of IDs, names or entries in a bulk packet.
+ */
+#define NS_BULK_MAX 64
 
 /**
 * Defines the possible packet types.
@@ -28,7 +52,10 @@ typedef enum ns_packet_type {
     ELECTION = 6,
     MASTER = 7,
     START_SYNC = 8,
-    SYNC = 9
+    SYNC = 9,
+    GET_NAMES = 10,
+    GET_IDS = 11,
+    NAME_IDS = 12
 } ns_packet_type_t;
 
 /**
@@ -44,22 +71,62 @@ typedef struct ns_packet {
     } payload;
 } __attribute((packed)) ns_packet_t;
 
+/**
+ * A resolved peer as carried by NAME_IDS. addr 0 means the sender itself.
+ */
+typedef struct ns_name_id {
+    unsigned short id;
+    char name[12];
+    unsigned int addr;
+} __attribute((packed)) ns_name_id_t;
+
+/**
+ * Packet structure of GET_NAMES, GET_IDS and NAME_IDS.
+ *
+ * Only the first count payload elements are sent, see ns_bulk_packet_size().
+ */
+typedef struct ns_bulk_packet {
+    unsigned short sender_id;
+    unsigned short type;
+    unsigned short count;
+    union {
+        unsigned short ids[NS_BULK_MAX];
+        char names[NS_BULK_MAX][12];
+        ns_name_id_t entries[NS_BULK_MAX];
+    } payload;
+} __attribute((packed)) ns_bulk_packet_t;
+
 /**
  * Holds the information about other clients.
  */
 typedef struct ns_peer
 {
     char name[12];
+    struct in_addr addr;
     time_val last_hello;
+    ns_phi_t hb;
 } ns_peer_t;
 
+/**
+ * Receives outgoing packets instead of the socket, see ns_set_send_hook().
+ */
+typedef void (*ns_send_hook_t)(const void *data, size_t len, const struct sockaddr_in *sa);
+
 void ns_init(int *sock, struct sockaddr_in *sa, int port);
+void ns_set_send_hook(ns_send_hook_t hook);
+
+int ns_is_bulk(unsigned short type);
+size_t ns_bulk_packet_size(unsigned short type, unsigned short count);
 
-void ns_send_HELLO(int sock, struct sockaddr_in sa, unsigned short id);
+void ns_send_HELLO(int sock, struct sockaddr_in sa, unsigned short id, time_val interval);
 void ns_send_GET_ID(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, unsigned short cid);
 void ns_send_GET_NAME(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, unsigned short cid);
 void ns_send_NAME_ID(int sock, struct sockaddr_in sa, unsigned short id, const char *name, struct sockaddr_in psa);
 
+void ns_send_GET_NAMES(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const unsigned short *cids, unsigned short count);
+void ns_send_GET_IDS(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const char names[][12], unsigned short count);
+void ns_send_NAME_IDS(int sock, struct sockaddr_in sa, unsigned short id, struct sockaddr_in psa, const ns_name_id_t *entries, unsigned short count);
+
 void ns_send_START_ELECTION(int sock, struct sockaddr_in sa, unsigned short id);
 void ns_send_ELECTION(int sock, struct sockaddr_in sa, unsigned short id);
 void ns_send_MASTER(int sock, struct sockaddr_in sa, unsigned short id);
@@ -0,0 +1,695 @@
+#include "node.h"
+#include "clock.h"
+
+#include <map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static unsigned short g_id;
+static const char *g_name;
+static int g_sock;
+static struct sockaddr_in g_sa;
+
+static unsigned short g_master_id;
+static unsigned short g_max_election_id;
+static int g_in_election = 0;
+static int g_master_in_sync = 0;
+static time_val g_master_sync_time = 0;
+static time_val g_client_sync_time = 0;
+static int g_wait_for_master = 0;
+static int g_wait_again = 0;
+static time_val g_hello_interval = NS_HELLO_TIMEOUT;
+static ns_phi_stats_t g_phi_stats;
+
+/**
+ * A peer removed by the failure detector, see peers_cleanup().
+ */
+typedef struct suspect {
+    time_val removed;
+    ns_phi_t hb;            /* kept for its loss counters */
+} suspect_t;
+
+static std::map<unsigned short, suspect_t> g_suspected;
+
+static std::map<unsigned short, ns_peer_t> g_peers;
+static std::vector<time_val> g_master_sync_timestamps;
+
+static time_val g_hello_wait_time;
+static time_val g_detect_wait_time;
+static time_val g_election_wait_time;
+static time_val g_sync_time_wait_time = 0;
+static time_val g_sync_start_time;
+
+/**
+ * A peer waiting for its name, see resolve_name().
+ */
+typedef struct resolve_entry {
+    struct sockaddr_in psa;
+    time_val requested;     /* 0 while still queued */
+} resolve_entry_t;
+
+static std::map<unsigned short, resolve_entry_t> g_resolving;
+static unsigned int g_resolve_queued = 0;
+static time_val g_resolve_flush_time;
+static time_val g_resolve_retry_time = 0;
+
+/**
+ * Simple helper function
+ */
+static void start_election()
+{
+    g_in_election = 1;
+    g_master_in_sync = 0;
+    g_wait_again = 1;
+    g_wait_for_master = 0;
+    ns_send_START_ELECTION(g_sock, g_sa, g_id);
+    printf("-> START_ELECTION\n");
+}
+
+static void send_master()
+{
+    g_wait_for_master = 0;
+    ns_send_MASTER(g_sock, g_sa, g_id);
+    printf("-> MASTER\n");
+}
+
+/**
+ * Adapt the HELLO interval to cluster size and observed loss, then send it.
+ */
+static void send_hello(std::map<unsigned short, ns_peer_t> &peers)
+{
+    double loss = 0;
+    for (std::map<unsigned short, ns_peer_t>::iterator it = peers.begin(); it != peers.end(); it++) {
+        loss += ns_phi_loss(&(*it).second.hb);
+    }
+    if (peers.size() > 0) {
+        loss /= peers.size();
+    }
+    g_hello_interval = ns_hello_interval(NS_HELLO_TIMEOUT, peers.size(), loss);
+    ns_send_HELLO(g_sock, g_sa, g_id, g_hello_interval);
+    printf("-> HELLO (interval %lld ms, loss %.1f%%)\n", g_hello_interval / 1000, loss * 100);
+}
+
+static void print_detector_stats()
+{
+    unsigned int s = g_phi_stats.suspicions;
+    printf("   Detector: %u suspicions, %u false positives (%.1f%%), latency avg %lld ms, max %lld ms\n",
+           s, g_phi_stats.false_positives, s ? 100.0 * g_phi_stats.false_positives / s : 0.0,
+           s ? g_phi_stats.latency_sum / s / 1000 : 0, g_phi_stats.latency_max / 1000);
+}
+
+static void peers_add(std::map<unsigned short, ns_peer_t> &peers, unsigned short id, struct in_addr addr)
+{
+    ns_peer_t info;
+    memset(&info, 0, sizeof(info));
+    strncpy(info.name, "", strlen(""));
+    info.addr = addr;
+    info.last_hello = get_time();
+    ns_phi_seed(&info.hb, info.last_hello);
+
+    /* A peer we removed recently is back, so it was never dead */
+    std::map<unsigned short, suspect_t>::iterator it = g_suspected.find(id);
+    if (it != g_suspected.end()) {
+        if (info.last_hello - (*it).second.removed < NS_PHI_FALSE_POSITIVE_WINDOW) {
+            printf("   Peer '%d' is back, suspicion was a false positive\n", id);
+            g_phi_stats.false_positives++;
+            print_detector_stats();
+        }
+        /* Keep its loss history, the HELLOs missed while it was gone count as lost */
+        const ns_phi_t *hb = &(*it).second.hb;
+        time_val n = (info.last_hello - hb->last + hb->interval / 2) / hb->interval;
+        info.hb.received = hb->received;
+        info.hb.missed = hb->missed + (n > 1 ? n - 1 : 0);
+        g_suspected.erase(it);
+    }
+    peers[id] = info;
+    //printf("   Added new peer '%d' with name '%s'\n", id, info.name);
+}
+
+static void peers_cleanup(std::map<unsigned short, ns_peer_t> &peers)
+{
+    //printf("   Check for clients which have not sent a HELLO recently...\n");
+    time_val now_time = get_time();
+    int start_e = 0;
+    for (std::map<unsigned short, ns_peer_t>::iterator it = peers.begin(); it != peers.end(); ) {
+        double phi = ns_phi_value(&(*it).second.hb, now_time);
+        if (phi > NS_PHI_THRESHOLD) {
+            // Latency is current time minus last time seen
+            time_val latency = now_time - (*it).second.hb.last;
+            printf("   Missing HELLO from '%d' (phi %.1f after %lld ms), remove from list\n",
+                   (*it).first, phi, latency / 1000);
+            g_phi_stats.suspicions++;
+            g_phi_stats.latency_sum += latency;
+            if (latency > g_phi_stats.latency_max) {
+                g_phi_stats.latency_max = latency;
+            }
+            g_suspected[(*it).first].removed = now_time;
+            g_suspected[(*it).first].hb = (*it).second.hb;
+            peers.erase(it++);
+            start_e = 1;
+        } else {
+            it++;
+        }
+    }
+    if (start_e) {
+        print_detector_stats();
+    }
+    for (std::map<unsigned short, suspect_t>::iterator it = g_suspected.begin(); it != g_suspected.end(); ) {
+        if (now_time - (*it).second.removed > NS_PHI_FALSE_POSITIVE_WINDOW) {
+            g_suspected.erase(it++);
+        } else {
+            it++;
+        }
+    }
+    if (start_e) {
+        start_election();
+    }
+}
+
+/**
+ * Send one GET_NAMES for all queued peers.
+ */
+static void resolve_flush()
+{
+    unsigned short ids[NS_BULK_MAX];
+    unsigned short count = 0;
+    struct sockaddr_in psa;
+    time_val now = get_time();
+
+    for (std::map<unsigned short, resolve_entry_t>::iterator it = g_resolving.begin(); it != g_resolving.end() && count < NS_BULK_MAX; it++) {
+        if ((*it).second.requested == 0) {
+            if (count == 0) {
+                psa = (*it).second.psa;
+            }
+            ids[count++] = (*it).first;
+            (*it).second.requested = now;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    g_resolve_queued -= count;
+
+    /* The master knows everybody, otherwise ask the first queued peer */
+    std::map<unsigned short, ns_peer_t>::iterator m = g_peers.find(g_master_id);
+    if (m != g_peers.end() && (*m).second.addr.s_addr != 0) {
+        psa.sin_addr = (*m).second.addr;
+    }
+    printf("-> GET_NAMES for %hu peers to '%s'.\n", count, inet_ntoa(psa.sin_addr));
+    ns_send_GET_NAMES(g_sock, g_sa, g_id, psa, ids, count);
+    if (g_resolve_retry_time == 0) {
+        g_resolve_retry_time = now + NS_RESOLVE_RETRY_TIMEOUT;
+    }
+}
+
+/**
+ * Ask each peer left unanswered by GET_NAMES for its name directly.
+ */
+static void resolve_retry()
+{
+    time_val now = get_time();
+
+    g_resolve_retry_time = 0;
+    for (std::map<unsigned short, resolve_entry_t>::iterator it = g_resolving.begin(); it != g_resolving.end(); ) {
+        time_val requested = (*it).second.requested;
+        if (requested != 0 && now - requested >= NS_RESOLVE_RETRY_TIMEOUT) {
+            printf("-> GET_NAME to '%d'.\n", (*it).first);
+            ns_send_GET_NAME(g_sock, g_sa, g_id, (*it).second.psa, (*it).first);
+            g_resolving.erase(it++);
+        } else {
+            if (requested != 0 && (g_resolve_retry_time == 0 || requested + NS_RESOLVE_RETRY_TIMEOUT < g_resolve_retry_time)) {
+                g_resolve_retry_time = requested + NS_RESOLVE_RETRY_TIMEOUT;
+            }
+            it++;
+        }
+    }
+}
+
+/**
+ * Ask for the name of a peer.
+ *
+ * Requests are collected for NS_RESOLVE_WINDOW and sent as one GET_NAMES.
+ */
+static void resolve_name(unsigned short id, struct sockaddr_in psa)
+{
+#if !NS_RESOLVE_BATCH
+    printf("-> GET_NAME to '%d'.\n", id);
+    ns_send_GET_NAME(g_sock, g_sa, g_id, psa, id);
+#else
+    if (g_resolving.count(id)) {
+        return;
+    }
+    resolve_entry_t entry;
+    entry.psa = psa;
+    entry.requested = 0;
+    g_resolving[id] = entry;
+    if (g_resolve_queued++ == 0) {
+        g_resolve_flush_time = get_time() + NS_RESOLVE_WINDOW;
+    }
+    if (g_resolve_queued == NS_BULK_MAX) {
+        resolve_flush();
+    }
+#endif
+}
+
+/**
+ * The name of a peer is known, stop asking for it.
+ */
+static void resolve_done(unsigned short id)
+{
+    std::map<unsigned short, resolve_entry_t>::iterator it = g_resolving.find(id);
+    if (it != g_resolving.end()) {
+        if ((*it).second.requested == 0) {
+            g_resolve_queued--;
+        }
+        g_resolving.erase(it);
+    }
+}
+
+/**
+ * Join the network: announce this node and start an election.
+ */
+void ns_node_init(int sock, struct sockaddr_in sa, unsigned short id, const char *name)
+{
+    g_sock = sock;
+    g_sa = sa;
+    g_id = id;
+    g_name = name;
+    g_master_id = g_id;
+
+    /* Send the first HELLO message to notify others of a new peer */
+    send_hello(g_peers);
+    /* Send the first START_ELECTION message to notify others of a new peer */
+    start_election();
+
+    /* Set the the various wait timeouts for different events.
+       Note that the first time out is actually an NS_ELECTION_TIMEOUT
+       because we initially send an START_ELECTION packet. */
+    g_hello_wait_time = get_time() + g_hello_interval;
+    g_detect_wait_time = get_time() + NS_PHI_CHECK_INTERVAL;
+    g_election_wait_time = get_time() + NS_ELECTION_TIMEOUT;
+    g_sync_start_time = get_time() + NS_TIME_SYNC_INTERVAL;
+}
+
+/**
+ * Point in time up to which to wait for packets before calling ns_node_timeout().
+ */
+time_val ns_node_next_timeout()
+{
+    time_val next;
+
+    if (g_in_election) {
+        next = g_election_wait_time;
+    } else if (g_master_in_sync) {
+        next = g_sync_time_wait_time;
+    } else {
+        next = g_hello_wait_time < g_detect_wait_time ? g_hello_wait_time : g_detect_wait_time;
+        if (g_master_id == g_id && g_sync_start_time < next) {
+            next = g_sync_start_time;
+        }
+    }
+    if (g_resolve_queued && g_resolve_flush_time < next) {
+        next = g_resolve_flush_time;
+    }
+    if (g_resolve_retry_time && g_resolve_retry_time < next) {
+        next = g_resolve_retry_time;
+    }
+    return next;
+}
+
+/**
+ * Handle a wait timeout.
+ */
+void ns_node_timeout()
+{
+    if (g_resolve_queued && g_resolve_flush_time <= get_time()) {
+        resolve_flush();
+    }
+    if (g_resolve_retry_time && g_resolve_retry_time <= get_time()) {
+        resolve_retry();
+    }
+
+    /* Handle election timeout if in election */
+    if (g_in_election && g_election_wait_time <= get_time()) {
+        if (g_wait_for_master) {
+            //printf("   Election timeout while waiting for MASTER.\n");
+            if (g_peers.size() == 0) {
+                send_master();  // Special case, no one is here
+            } else {
+                start_election();
+            }
+        } else {
+            if (g_wait_again) {
+                g_wait_again = 0;
+                time_val election_wait_time = get_time() + NS_ELECTION_TIMEOUT;
+            } else {
+                //printf("   Election timeout while waiting for ELECTION.\n");
+                send_master();
+            }
+        }
+        //printf("   Next election wait time: '%lld'.\n", g_election_wait_time);
+    }
+
+    if (g_hello_wait_time < get_time()) {
+        /* HELLO message wait timeout, send another one */
+        send_hello(g_peers);
+        g_hello_wait_time = get_time() + g_hello_interval;
+        //printf("   Next hello wait time: '%lld'\n", g_hello_wait_time);
+    }
+    if (g_detect_wait_time < get_time()) {
+        /* Check the suspicion level of all peers */
+        peers_cleanup(g_peers);
+        g_detect_wait_time = get_time() + NS_PHI_CHECK_INTERVAL;
+    }
+    //printf("   Timeout occured, hello: '%lld' and election: '%lld'\n", g_hello_wait_time, g_election_wait_time);
+
+    /* If master then check for time sync stuff. Rounds start at a fixed rate, independent of HELLO. */
+    if (g_master_id == g_id && !g_in_election) {
+        if (!g_master_in_sync && g_sync_start_time <= get_time()) {
+            g_sync_start_time = get_time() + NS_TIME_SYNC_INTERVAL;
+            g_master_in_sync = 1;
+            g_master_sync_timestamps.clear();
+            g_master_sync_timestamps.push_back(get_time());
+            printf("-> START_SYNC\n");
+            ns_send_START_SYNC(g_sock, g_sa, g_id);
+            g_sync_time_wait_time = get_time() + NS_TIME_SYNC_TIMEOUT;
+        } else if (g_master_in_sync) {
+            /* Handle if we are in time sync state */
+            if (g_sync_time_wait_time < get_time()) {
+                //printf("   Wait time gone, do sth.\n");
+                time_val sum = 0;
+                for (std::vector<time_val>::iterator it = g_master_sync_timestamps.begin(); it != g_master_sync_timestamps.end(); it++) {
+                    sum += *it;
+                }
+                time_val new_time = sum / g_master_sync_timestamps.size();
+                printf("-> SYNC (master)\n");
+                ns_send_SYNC(g_sock, g_sa, g_id, new_time);
+                g_master_in_sync = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Handle a (non bulk) packet received from psa.
+ */
+static void receive_packet(ns_packet_t *pack, struct sockaddr_in psa)
+{
+    unsigned short sender_id = ntohs(pack->sender_id);
+    switch (ntohs(pack->type)) {
+        case HELLO: {
+            /* Peers not advertising their interval use the fixed one */
+            time_val interval = net2time(pack->payload.time);
+            if (interval <= 0) {
+                interval = NS_HELLO_TIMEOUT;
+            } else if (interval < NS_HELLO_MIN_TIMEOUT) {
+                interval = NS_HELLO_MIN_TIMEOUT;
+            } else if (interval > NS_HELLO_MAX_TIMEOUT) {
+                interval = NS_HELLO_MAX_TIMEOUT;
+            }
+            printf("<- HELLO from '%d'.\n", sender_id);
+            if (sender_id != g_id) {
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    ns_phi_heartbeat(&g_peers[sender_id].hb, get_time(), interval);
+                } else {
+                    g_peers[sender_id].last_hello = get_time();
+                    ns_phi_heartbeat(&g_peers[sender_id].hb, get_time(), interval);
+                    //printf("   Updated last HELLO timestamp for peer.\n");
+                }
+                if (strlen(g_peers[sender_id].name) == 0) {
+                    resolve_name(sender_id, psa);
+                }
+            }
+            break;
+        }
+        case GET_ID: {
+            printf("<- GET_ID from '%d' to name '%s'.\n", sender_id, pack->payload.name);
+            if (sender_id != g_id && strncmp(pack->payload.name, g_name, strlen(g_name))) {
+                //printf("   Message was for me, send NAME_ID message to '%d'.\n", sender_id);
+                printf("-> NAME_ID to '%d'.\n", sender_id);
+                ns_send_NAME_ID(g_sock, g_sa, g_id, g_name, psa);
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    resolve_name(sender_id, psa);
+                }
+            }
+            break;
+        }
+        case GET_NAME: {
+            unsigned short payload_id = ntohs(pack->payload.id);
+            printf("<- GET_NAME from '%d' to '%hd'.\n", sender_id, payload_id);
+            if (sender_id != g_id && payload_id == g_id) {
+                printf("-> NAME_ID to '%d'.\n", sender_id);
+                ns_send_NAME_ID(g_sock, g_sa, g_id, g_name, psa);
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    resolve_name(sender_id, psa);
+                }
+            }
+            break;
+        }
+        case NAME_ID: {
+            pack->payload.name[11] = '\0';
+            printf("<- NAME_ID from '%d' with name '%s'.\n", sender_id, pack->payload.name);
+            if (sender_id != g_id) {
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                }
+                strncpy(g_peers[sender_id].name, pack->payload.name, strlen(pack->payload.name));
+                resolve_done(sender_id);
+                //printf("   Updated peer '%d' with name '%s'\n", sender_id, g_peers[sender_id].name);
+            }
+            break;
+        }
+        case START_ELECTION: {
+            printf("<- START_ELECTION from '%d' (%lld).\n", sender_id, get_time());
+            if (sender_id != g_id) {
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    resolve_name(sender_id, psa);
+                }
+                g_in_election = 1;
+            }
+
+            if (g_master_in_sync) {
+                printf("   Time sync was interrupted by START_SYNC...\n");
+                g_master_in_sync = 0;
+            }
+
+            if (sender_id < g_id) {
+                printf("-> ELECTION (%lld)\n", get_time());
+                g_wait_for_master = 0;
+                ns_send_ELECTION(g_sock, g_sa, g_id);
+                g_election_wait_time = get_time() + NS_ELECTION_TIMEOUT;
+            } else if (sender_id == g_id) {
+                g_wait_for_master = 0;
+                g_election_wait_time = get_time() + NS_ELECTION_TIMEOUT;
+            } else {
+                g_wait_for_master = 1;
+                g_election_wait_time = get_time() + NS_MASTER_TIMEOUT;
+            }
+            break;
+        }
+        case ELECTION: {
+            printf("<- ELECTION from '%d' (%lld).\n", sender_id, get_time());
+            if (sender_id != g_id) {
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    resolve_name(sender_id, psa);
+                }
+                if (!g_in_election) {
+                    printf("   Not in an election, start a new one!\n");
+                    start_election();
+                } else {
+                    g_wait_again = 0;
+                    if (sender_id > g_id) {
+                        g_wait_for_master = 1;
+                        g_election_wait_time = get_time() + NS_MASTER_TIMEOUT;
+                        //printf("   Someone voted higher, wait for MASTER.\n");
+                    }
+                }
+            }
+            break;
+        }
+        case MASTER: {
+            printf("<- MASTER from '%d' (%lld).\n", sender_id, get_time());
+            if (sender_id != g_id) {
+                if (g_peers.count(sender_id) == 0) {
+                    peers_add(g_peers, sender_id, psa.sin_addr);
+                    resolve_name(sender_id, psa);
+                }
+            }
+            if (!g_in_election || sender_id < g_id) {
+                start_election();
+            } else {
+                g_in_election = 0;
+                g_wait_again = 0;
+                g_wait_for_master = 0;
+                g_master_id = sender_id;
+            }
+            break;
+        }
+        case START_SYNC: {
+            printf("<- START_SYNC from '%d' (%lld).\n", sender_id, get_time());
+            if (sender_id != g_master_id) {
+                /* Obviously the wrong peer send the START_SYNC package. */
+                start_election();
+            } else {
+                /* Only respond here if I'm not the master and thus this package was not sent by me. */
+                if (g_master_id != g_id) {
+                    printf("-> SYNC to '%d'.\n", sender_id);
+                    g_client_sync_time = get_time();
+                    ns_send_SYNC(g_sock, g_sa, g_id, g_client_sync_time, psa);
+                }
+            }
+            break;
+        }
+        case SYNC: {
+            printf("<- SYNC from '%d' (%lld).\n", sender_id, get_time());
+            if (g_master_id == g_id) {  /* If I'm the master */
+                /* Add this timestamp to received sync timestamps */
+                g_master_sync_timestamps.push_back(net2time(pack->payload.time));
+            } else { /* I'm a slave */
+                time_val time_sync_diff = net2time(pack->payload.time) - g_client_sync_time;
+                adjust_time(time_sync_diff);
+                g_hello_wait_time += time_sync_diff;
+                for (std::map<unsigned short, ns_peer_t>::iterator it = g_peers.begin(); it != g_peers.end(); it++) {
+                    (*it).second.hb.last += time_sync_diff;
+                }
+                //g_election_wait_time += time_sync_diff;
+                //printf("   Adjusted time by diff '%lld'\n", time_sync_diff);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Append the entry for peer id to a NAME_IDS answer if its name is known.
+ */
+static void add_name_id(ns_name_id_t *entries, unsigned short *count, unsigned short id)
+{
+    ns_name_id_t *entry = &entries[*count];
+
+    memset(entry, 0, sizeof(ns_name_id_t));
+    if (id == g_id) {
+        entry->id = g_id;
+        strncpy(entry->name, g_name, sizeof(entry->name) - 1);
+        (*count)++;
+    } else if (g_peers.count(id) && strlen(g_peers[id].name) > 0 && g_peers[id].addr.s_addr != 0) {
+        entry->id = id;
+        strncpy(entry->name, g_peers[id].name, sizeof(entry->name) - 1);
+        entry->addr = g_peers[id].addr.s_addr;
+        (*count)++;
+    }
+}
+
+/**
+ * Handle a GET_NAMES, GET_IDS or NAME_IDS packet with count payload elements.
+ */
+static void receive_bulk(ns_bulk_packet_t *pack, unsigned short count, struct sockaddr_in psa)
+{
+    unsigned short sender_id = ntohs(pack->sender_id);
+    ns_name_id_t entries[NS_BULK_MAX];
+    unsigned short n = 0;
+
+    if (sender_id == g_id) {
+        return;
+    }
+    switch (ntohs(pack->type)) {
+        case GET_NAMES: {
+            printf("<- GET_NAMES from '%d' for %hu peers.\n", sender_id, count);
+            for (unsigned short i = 0; i < count; i++) {
+                add_name_id(entries, &n, ntohs(pack->payload.ids[i]));
+            }
+            break;
+        }
+        case GET_IDS: {
+            printf("<- GET_IDS from '%d' for %hu names.\n", sender_id, count);
+            for (unsigned short i = 0; i < count; i++) {
+                char *name = pack->payload.names[i];
+                name[11] = '\0';
+                if (strcmp(name, g_name) == 0) {
+                    add_name_id(entries, &n, g_id);
+                    continue;
+                }
+                for (std::map<unsigned short, ns_peer_t>::iterator it = g_peers.begin(); it != g_peers.end(); it++) {
+                    if (strcmp(name, (*it).second.name) == 0) {
+                        add_name_id(entries, &n, (*it).first);
+                        break;
+                    }
+                }
+            }
+            break;
+        }
+        case NAME_IDS: {
+            printf("<- NAME_IDS from '%d' with %hu entries.\n", sender_id, count);
+            for (unsigned short i = 0; i < count; i++) {
+                ns_name_id_t *entry = &pack->payload.entries[i];
+                unsigned short id = ntohs(entry->id);
+                /* Only peers we asked about and still know, never overwrite a known name */
+                if (id == g_id || g_resolving.count(id) == 0 || g_peers.count(id) == 0) {
+                    continue;
+                }
+                entry->name[11] = '\0';
+                strncpy(g_peers[id].name, entry->name, sizeof(g_peers[id].name));
+                g_peers[id].addr.s_addr = entry->addr ? entry->addr : psa.sin_addr.s_addr;
+                resolve_done(id);
+            }
+            return;
+        }
+    }
+    if (n > 0) {
+        printf("-> NAME_IDS with %hu entries to '%d'.\n", n, sender_id);
+        ns_send_NAME_IDS(g_sock, g_sa, g_id, psa, entries, n);
+    }
+    if (g_peers.count(sender_id) == 0) {
+        peers_add(g_peers, sender_id, psa.sin_addr);
+        resolve_name(sender_id, psa);
+    }
+}
+
+/**
+ * Handle a datagram of len bytes received from psa.
+ */
+void ns_node_receive(const void *data, size_t len, struct sockaddr_in psa)
+{
+    if (len >= offsetof(ns_bulk_packet_t, payload) && ns_is_bulk(ntohs(((const ns_packet_t *)data)->type))) {
+        ns_bulk_packet_t bulk;
+        memset(&bulk, 0, sizeof(bulk));
+        memcpy(&bulk, data, len < sizeof(bulk) ? len : sizeof(bulk));
+        unsigned short count = ntohs(bulk.count);
+        if (count > NS_BULK_MAX || len < ns_bulk_packet_size(ntohs(bulk.type), count)) {
+            fprintf(stderr, "Error: Truncated bulk packet!\n");
+            return;
+        }
+        receive_bulk(&bulk, count, psa);
+    } else {
+        ns_packet_t pack;
+        memset(&pack, 0, sizeof(pack));
+        memcpy(&pack, data, len < sizeof(pack) ? len : sizeof(pack));
+        receive_packet(&pack, psa);
+    }
+}
+
+/**
+ * Snapshot of the election and sync state.
+ */
+void ns_node_state(ns_node_state_t *state)
+{
+    state->master_id = g_master_id;
+    state->in_election = g_in_election;
+    state->wait_for_master = g_wait_for_master;
+    state->master_in_sync = g_master_in_sync;
+    state->peers = g_peers.size();
+    state->named = 0;
+    for (std::map<unsigned short, ns_peer_t>::iterator it = g_peers.begin(); it != g_peers.end(); it++) {
+        if (strlen((*it).second.name) > 0) {
+            state->named++;
+        }
+    }
+}
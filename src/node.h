@@ -0,0 +1,24 @@
+#ifndef NODE_H
+#define NODE_H
+
+#include "name.h"
+
+/**
+ * Election and sync state of the node, see ns_node_state().
+ */
+typedef struct ns_node_state {
+    unsigned short master_id;
+    int in_election;
+    int wait_for_master;
+    int master_in_sync;
+    unsigned int peers;
+    unsigned int named;     /* peers with a known name */
+} ns_node_state_t;
+
+void ns_node_init(int sock, struct sockaddr_in sa, unsigned short id, const char *name);
+time_val ns_node_next_timeout();
+void ns_node_timeout();
+void ns_node_receive(const void *data, size_t len, struct sockaddr_in psa);
+void ns_node_state(ns_node_state_t *state);
+
+#endif
@@ -0,0 +1,331 @@
+#include "capture.h"
+#include "name.h"
+#include "node.h"
+#include "vclock.h"
+
+#include <deque>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Virtual time a spinning timeout advances the clock by in [us]
+ */
+#define NS_REPLAY_MIN_STEP 1000
+
+static FILE *g_log = NULL;
+static FILE *g_ref = NULL;
+static time_val g_start;
+static unsigned long g_lines = 0;
+static unsigned long g_mismatches = 0;
+static unsigned long g_first_mismatch = 0;
+static unsigned long g_sent = 0;
+static unsigned long g_transitions = 0;
+
+/* Time spent in the node handlers and, within them, in replay_sent() in [us] */
+static time_val g_handler_time = 0;
+static time_val g_hook_time = 0;
+
+/**
+ * A broadcast of the replayed node, delivered back to it like the network does.
+ */
+typedef struct loopback {
+    ns_bulk_packet_t pack;
+    size_t len;
+} loopback_t;
+
+static std::deque<loopback_t> g_loopback;
+
+static const char *packet_type_name(unsigned short type)
+{
+    static const char *names[] = {
+        "?", "HELLO", "GET_ID", "GET_NAME", "NAME_ID", "START_ELECTION",
+        "ELECTION", "MASTER", "START_SYNC", "SYNC", "GET_NAMES", "GET_IDS", "NAME_IDS"
+    };
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+static time_val now_monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (time_val)ts.tv_sec * 1000 * 1000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Write a line to the transition log and compare it with the reference log.
+ */
+static void log_line(const char *line)
+{
+    g_lines++;
+    if (g_log) {
+        fputs(line, g_log);
+    }
+    if (g_ref) {
+        char ref[256];
+        if (fgets(ref, sizeof(ref), g_ref) == NULL || strcmp(ref, line)) {
+            if (g_mismatches++ == 0) {
+                g_first_mismatch = g_lines;
+                fprintf(stderr, "First divergence at line %lu:\n  this:      %s  reference: %s",
+                        g_lines, line, g_ref && !feof(g_ref) ? ref : "<end of log>\n");
+            }
+        }
+    }
+}
+
+static void log_state(const char *event)
+{
+    static ns_node_state_t last;
+    static int have_last = 0;
+    ns_node_state_t state;
+    char line[256];
+
+    /* Zero the padding as well, states are compared with memcmp() */
+    memset(&state, 0, sizeof(state));
+    ns_node_state(&state);
+    if (have_last && !memcmp(&state, &last, sizeof(state))) {
+        return;
+    }
+    have_last = 1;
+    last = state;
+    g_transitions++;
+    snprintf(line, sizeof(line), "%lld %s master=%hu election=%d wait_master=%d sync=%d peers=%u named=%u\n",
+             get_time() - g_start, event, state.master_id, state.in_election,
+             state.wait_for_master, state.master_in_sync, state.peers, state.named);
+    log_line(line);
+}
+
+static void replay_sent(const void *data, size_t len, const struct sockaddr_in *sa)
+{
+    const ns_packet_t *pack = (const ns_packet_t *)data;
+    char line[256];
+    time_val t = now_monotonic();
+
+    g_sent++;
+    snprintf(line, sizeof(line), "%lld -> %s %s\n", get_time() - g_start,
+             packet_type_name(ntohs(pack->type)), inet_ntoa(sa->sin_addr));
+    log_line(line);
+
+    if (sa->sin_addr.s_addr == htonl(INADDR_BROADCAST)) {
+        loopback_t lb;
+        memset(&lb, 0, sizeof(lb));
+        lb.len = len < sizeof(lb.pack) ? len : sizeof(lb.pack);
+        memcpy(&lb.pack, data, lb.len);
+        g_loopback.push_back(lb);
+    }
+    g_hook_time += now_monotonic() - t;
+}
+
+/**
+ * Run a node handler, timing only the node and not the logging of its sends.
+ */
+static void timed_receive(const void *data, size_t len, struct sockaddr_in psa)
+{
+    time_val hook = g_hook_time, t = now_monotonic();
+    ns_node_receive(data, len, psa);
+    g_handler_time += now_monotonic() - t - (g_hook_time - hook);
+}
+
+static void timed_timeout()
+{
+    time_val hook = g_hook_time, t = now_monotonic();
+    ns_node_timeout();
+    g_handler_time += now_monotonic() - t - (g_hook_time - hook);
+}
+
+/**
+ * Hand the node its own broadcasts, sent by the handler that just returned.
+ *
+ * @return Number of delivered packets
+ */
+static unsigned long deliver_loopback()
+{
+    struct sockaddr_in psa;
+    unsigned long n = 0;
+
+    memset(&psa, 0, sizeof(psa));
+    psa.sin_family = AF_INET;
+    psa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    psa.sin_port = htons(NS_DEFAULT_PORT);
+    while (!g_loopback.empty()) {
+        loopback_t lb = g_loopback.front();
+        g_loopback.pop_front();
+        timed_receive(&lb.pack, lb.len, psa);
+        log_state(packet_type_name(ntohs(lb.pack.type)));
+        n++;
+    }
+    return n;
+}
+
+/**
+ * In real time mode, sleep until the wall clock catches up with 'vt'.
+ */
+static void wait_real_time(int real_time, time_val wall_start, time_val vt)
+{
+    if (real_time) {
+        time_val delay = (vt - g_start) - (now_monotonic() - wall_start);
+        if (delay > 0) {
+            usleep(delay);
+        }
+    }
+}
+
+static void print_usage(const char *prog_name)
+{
+    fprintf(stderr, "Usage: %s [-r] [-v] [-o LOG] [-c REFERENCE] CAPTURE\n"
+           "    -r : replay in real time instead of as fast as possible\n"
+           "    -v : show the output of the replayed node\n"
+           "    -o : write state transitions and sent packets to LOG\n"
+           "    -c : compare state transitions with a LOG of another build\n", prog_name);
+}
+
+int main(int argc, char *argv[])
+{
+    int real_time = 0, verbose = 0, opt;
+    const char *log_path = NULL, *ref_path = NULL;
+
+    while ((opt = getopt(argc, argv, "rvo:c:")) != -1) {
+        switch (opt) {
+            case 'r': real_time = 1; break;
+            case 'v': verbose = 1; break;
+            case 'o': log_path = optarg; break;
+            case 'c': ref_path = optarg; break;
+            default: print_usage(argv[0]); exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    FILE *f = fopen(argv[optind], "rb");
+    if (f == NULL) {
+        perror("fopen"); exit(2);
+    }
+    ns_capture_header_t header;
+    if (ns_capture_read_header(f, &header)) {
+        fprintf(stderr, "Error: '%s' is not a capture file!\n", argv[optind]);
+        exit(2);
+    }
+    if (log_path && (g_log = fopen(log_path, "w")) == NULL) {
+        perror("fopen"); exit(2);
+    }
+    if (ref_path && (g_ref = fopen(ref_path, "r")) == NULL) {
+        perror("fopen"); exit(2);
+    }
+    if (!verbose) {
+        /* The node reports every packet, which would dominate the replay time */
+        freopen("/dev/null", "w", stdout);
+    }
+
+    ns_capture_record_t rec;
+    ns_bulk_packet_t pack;
+    size_t len;
+    if (ns_capture_read(f, &rec, &pack, sizeof(pack), &len)) {
+        fprintf(stderr, "Error: capture is empty!\n");
+        exit(2);
+    }
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(NS_DEFAULT_PORT);
+
+    unsigned long received = 0, looped = 0, skipped = 0, captured_sent = 0, timeouts = 0;
+    time_val wall_start = now_monotonic();
+
+    g_start = net2time(rec.time);
+    vclock_set(g_start);
+    ns_set_send_hook(replay_sent);
+
+    ns_node_init(-1, sa, ntohs(header.id), header.name);
+    log_state("init");
+    looped += deliver_loopback();
+
+    do {
+        time_val rec_time = net2time(rec.time);
+
+        /* Fire all timeouts the node would have hit before this packet */
+        while (1) {
+            time_val now = get_time();
+            time_val next = ns_node_next_timeout();
+            if (next <= now) {
+                next = now + NS_REPLAY_MIN_STEP;
+            }
+            if (next > rec_time) {
+                break;
+            }
+            wait_real_time(real_time, wall_start, next);
+            vclock_set(next);
+            timed_timeout();
+            log_state("timeout");
+            looped += deliver_loopback();
+            timeouts++;
+        }
+
+        wait_real_time(real_time, wall_start, rec_time);
+        vclock_set(rec_time);
+        if (rec.dir == NS_CAPTURE_SENT) {
+            /* Sent packets are the reaction of the recorded node, not input */
+            captured_sent++;
+            continue;
+        }
+        if (len >= sizeof(ns_packet_t) && ntohs(pack.sender_id) == ntohs(header.id)) {
+            /* The recorded node's own broadcasts, the replayed node loops back its own */
+            skipped++;
+            continue;
+        }
+
+        struct sockaddr_in psa;
+        memset(&psa, 0, sizeof(psa));
+        psa.sin_family = AF_INET;
+        psa.sin_addr.s_addr = rec.addr;
+        psa.sin_port = rec.port;
+
+        timed_receive(&pack, len, psa);
+        log_state(packet_type_name(ntohs(pack.type)));
+        looped += deliver_loopback();
+        received++;
+    } while (ns_capture_read(f, &rec, &pack, sizeof(pack), &len) == 0);
+
+    time_val wall_time = now_monotonic() - wall_start;
+    unsigned long events = received + looped + timeouts;
+
+    fprintf(stderr, "Replayed '%s' (node %hu '%s'), %.3f s of capture in %.3f s\n",
+            argv[optind], ntohs(header.id), header.name,
+            (get_time() - g_start) / 1e6, wall_time / 1e6);
+    fprintf(stderr, "  Packets: %lu received, %lu own skipped, %lu looped back, %lu sent (%lu in capture)\n",
+            received, skipped, looped, g_sent, captured_sent);
+    fprintf(stderr, "  Handlers: %lu events in %.3f ms, %.0f events/s\n",
+            events, g_handler_time / 1e3, g_handler_time > 0 ? events * 1e6 / g_handler_time : 0.0);
+    fprintf(stderr, "  State transitions: %lu\n", g_transitions);
+
+    int ret = 0;
+    if (g_ref) {
+        char ref[256];
+        while (fgets(ref, sizeof(ref), g_ref)) {
+            /* Reference log is longer than this one */
+            if (g_mismatches++ == 0) {
+                g_first_mismatch = g_lines + 1;
+                fprintf(stderr, "First divergence at line %lu:\n  this:      <end of log>\n  reference: %s",
+                        g_first_mismatch, ref);
+            }
+        }
+        if (g_mismatches) {
+            fprintf(stderr, "  Compared with '%s': %lu lines differ, first at line %lu\n",
+                    ref_path, g_mismatches, g_first_mismatch);
+            ret = 3;
+        } else {
+            fprintf(stderr, "  Compared with '%s': identical\n", ref_path);
+        }
+        fclose(g_ref);
+    }
+    if (g_log) {
+        fclose(g_log);
+    }
+    fclose(f);
+    return ret;
+}
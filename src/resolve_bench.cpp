@@ -0,0 +1,195 @@
+#include "name.h"
+#include "node.h"
+#include "vclock.h"
+
+#include <map>
+#include <string>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Round trip time of the simulated network in [us]
+ */
+#define NS_BENCH_RTT 1000
+
+/**
+ * Peers answer the START_ELECTION of the new node within this time in [us]
+ */
+#define NS_BENCH_ELECTION_SPREAD (50 * 1000)
+
+/**
+ * Give up after this much virtual time in [us]
+ */
+#define NS_BENCH_LIMIT (10 * 1000 * 1000)
+
+/**
+ * Id of the first simulated peer, all of them outvote the new node.
+ */
+#define NS_BENCH_FIRST_PEER 1000
+
+/**
+ * A datagram on its way to the new node.
+ */
+typedef struct bench_packet {
+    std::string data;
+    unsigned short from;
+} bench_packet_t;
+
+static std::multimap<time_val, bench_packet_t> g_queue;
+static unsigned long g_requests = 0;
+static unsigned long g_responses = 0;
+static int g_legacy = 0;
+
+static struct sockaddr_in peer_addr(unsigned short id)
+{
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(NS_DEFAULT_PORT);
+    sa.sin_addr.s_addr = htonl(0x0a000000 + id);
+    return sa;
+}
+
+static void deliver_at(time_val t, const void *data, size_t len, unsigned short from)
+{
+    bench_packet_t p;
+    p.data.assign((const char *)data, len);
+    p.from = from;
+    g_queue.insert(std::make_pair(t, p));
+}
+
+/**
+ * The simulated peers: every one answers requests for its own name, the
+ * one asked with GET_NAMES knows all names (unless -l is given).
+ */
+static void bench_sent(const void *data, size_t, const struct sockaddr_in *sa)
+{
+    const ns_packet_t *pack = (const ns_packet_t *)data;
+    unsigned short to = ntohl(sa->sin_addr.s_addr) - 0x0a000000;
+
+    switch (ntohs(pack->type)) {
+        case GET_NAME: {
+            ns_packet_t answer;
+            g_requests++;
+            memset(&answer, 0, sizeof(answer));
+            answer.sender_id = htons(to);
+            answer.type = htons(NAME_ID);
+            snprintf(answer.payload.name, sizeof(answer.payload.name), "p%hu", to);
+            deliver_at(get_time() + NS_BENCH_RTT, &answer, sizeof(answer), to);
+            break;
+        }
+        case GET_NAMES: {
+            const ns_bulk_packet_t *request = (const ns_bulk_packet_t *)data;
+            unsigned short count = ntohs(request->count);
+            ns_bulk_packet_t answer;
+            g_requests++;
+            if (g_legacy) {
+                break;
+            }
+            memset(&answer, 0, sizeof(answer));
+            answer.sender_id = htons(to);
+            answer.type = htons(NAME_IDS);
+            answer.count = request->count;
+            for (unsigned short i = 0; i < count; i++) {
+                unsigned short id = ntohs(request->payload.ids[i]);
+                answer.payload.entries[i].id = request->payload.ids[i];
+                snprintf(answer.payload.entries[i].name, sizeof(answer.payload.entries[i].name), "p%hu", id);
+                answer.payload.entries[i].addr = peer_addr(id).sin_addr.s_addr;
+            }
+            deliver_at(get_time() + NS_BENCH_RTT, &answer, ns_bulk_packet_size(NAME_IDS, count), to);
+            break;
+        }
+    }
+}
+
+/**
+ * Count the answers to name requests on their way to the new node.
+ */
+static void count_responses(const bench_packet_t *p)
+{
+    const ns_packet_t *pack = (const ns_packet_t *)p->data.data();
+
+    if (ntohs(pack->type) == NAME_ID || ntohs(pack->type) == NAME_IDS) {
+        g_responses++;
+    }
+}
+
+static void print_usage(const char *prog_name)
+{
+    fprintf(stderr, "Usage: %s [-n PEERS] [-l]\n"
+           "    -n : number of peers already in the network (default 1000)\n"
+           "    -l : peers do not understand GET_NAMES\n", prog_name);
+}
+
+int main(int argc, char *argv[])
+{
+    int peers = 1000, opt;
+
+    while ((opt = getopt(argc, argv, "n:l")) != -1) {
+        switch (opt) {
+            case 'n': peers = atoi(optarg); break;
+            case 'l': g_legacy = 1; break;
+            default: print_usage(argv[0]); exit(1);
+        }
+    }
+    if (peers < 1 || NS_BENCH_FIRST_PEER + peers > USHRT_MAX) {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    /* The node reports every packet */
+    freopen("/dev/null", "w", stdout);
+    srandom(1);
+
+    time_val start = 1000LL * 1000 * 1000 * 1000;
+    vclock_set(start);
+    ns_set_send_hook(bench_sent);
+
+    struct sockaddr_in sa = peer_addr(0);
+    ns_node_init(-1, sa, NS_BENCH_FIRST_PEER / 2, "bench");
+
+    /* Everybody answers the START_ELECTION of the new node */
+    for (int i = 0; i < peers; i++) {
+        ns_packet_t pack;
+        memset(&pack, 0, sizeof(pack));
+        pack.sender_id = htons(NS_BENCH_FIRST_PEER + i);
+        pack.type = htons(ELECTION);
+        deliver_at(start + NS_BENCH_RTT + random() % NS_BENCH_ELECTION_SPREAD, &pack, sizeof(pack), NS_BENCH_FIRST_PEER + i);
+    }
+
+    ns_node_state_t state;
+    time_val done = 0;
+    while (!done && get_time() < start + NS_BENCH_LIMIT) {
+        time_val now = get_time();
+        time_val next = ns_node_next_timeout();
+        if (next <= now) {
+            next = now + NS_BENCH_RTT;
+        }
+        if (g_queue.empty() || next < g_queue.begin()->first) {
+            vclock_set(next);
+            ns_node_timeout();
+            continue;
+        }
+
+        bench_packet_t p = g_queue.begin()->second;
+        vclock_set(g_queue.begin()->first);
+        g_queue.erase(g_queue.begin());
+        count_responses(&p);
+        ns_node_receive(p.data.data(), p.data.size(), peer_addr(p.from));
+        /* Done once the node stored every name, not when they were sent */
+        ns_node_state(&state);
+        if ((int)state.named == peers) {
+            done = get_time();
+        }
+    }
+
+    ns_node_state(&state);
+    fprintf(stderr, "%s: %u of %d names after %.1f ms, %lu requests + %lu responses = %lu packets\n",
+            NS_RESOLVE_BATCH ? "GET_NAMES" : "GET_NAME", state.named, peers,
+            ((done ? done : get_time()) - start) / 1e3, g_requests, g_responses, g_requests + g_responses);
+    return done ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include "vclock.h"
+
+/* Virtual clock replacing obj/clock.o for replays, only moves when told to. */
+static time_val g_now = 0;
+
+extern "C" void clock_init()
+{
+}
+
+extern "C" void clock_setup(time_val t_offset, time_val)
+{
+    g_now += t_offset;
+}
+
+extern "C" void vclock_set(time_val now)
+{
+    g_now = now;
+}
+
+extern "C" time_val get_time()
+{
+    return g_now;
+}
+
+extern "C" void adjust_time(time_val diff)
+{
+    g_now += diff;
+}
+
+extern "C" int poll_time(time_val abstime)
+{
+    time_val diff = abstime - g_now;
+    return diff < 0 ? 0 : diff / 1000;
+}
+
+/* Same big endian format as obj/clock.o, captures are shared between both */
+extern "C" void time2net(time_val tv, char *addr)
+{
+    for (int i = 0; i < 8; i++) {
+        addr[i] = (char)(tv >> (8 * (7 - i)));
+    }
+}
+
+extern "C" time_val net2time(char *addr)
+{
+    time_val tv = 0;
+    for (int i = 0; i < 8; i++) {
+        tv = (tv << 8) | (unsigned char)addr[i];
+    }
+    return tv;
+}
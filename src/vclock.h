@@ -0,0 +1,11 @@
+#ifndef VCLOCK_H
+#define VCLOCK_H
+
+#include "clock.h"
+
+/**
+ * Set the virtual clock that replaces obj/clock.o in the replay tool.
+ */
+extern "C" void vclock_set(time_val now);
+
+#endif